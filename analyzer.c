@@ -3,33 +3,247 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <limits.h>
 
 // POSIX
+#include <pthread.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <libgen.h>
 
 #include "parser.h"
+#include "emitter.h"
+#include "scheduler.h"
+#include "cache.h"
+#include "server.h"
+#include "stats.h"
+#include "analyzer.h"
 
-#define JACK_XML_EXTENSION "xml"
 #define JACK_FILE_EXTENSION ".jack"
 #define MAX_FILENAME_LENGTH 256
 
-bool analyze_file(const char *jack_file)
+// Names, file extensions and emitters of the output formats, indexed by OUTPUT_FORMAT.
+// The binary format needs the whole tree and has no emitter
+static const char *format_names[] = {"xml", "compact-xml", "json", "binary"};
+static const char *format_extensions[] = {"xml", "xml", "json", "ast"};
+static const Emitter *format_emitters[] = {&xml_emitter, &compact_xml_emitter, &json_emitter, NULL};
+
+bool write_fd(void *ctx, const char *data, size_t size)
+{
+  int fd = *(int *)ctx;
+
+  while (size > 0)
+  {
+    ssize_t n = write(fd, data, size);
+
+    if (n == -1)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    data += n;
+    size -= n;
+  }
+
+  return true;
+}
+
+// Creates a new temporary file next to the output file in the directory dirfd.
+// The name of the file is stored in tmp_filename
+int create_temp_file(int dirfd, const char *xml_filename, char *tmp_filename, size_t tmp_size)
+{
+  static atomic_uint counter = 0;
+  const char *xml_basename = strrchr(xml_filename, '/');
+  int dir_length = xml_basename == NULL ? 0 : xml_basename + 1 - xml_filename;
+  int fd;
+
+  xml_basename = xml_filename + dir_length;
+
+  do
+  {
+    snprintf(tmp_filename, tmp_size, "%.*s.%s.%ld.%u.tmp", dir_length, xml_filename, xml_basename,
+             (long)getpid(), atomic_fetch_add(&counter, 1));
+
+    fd = openat(dirfd, tmp_filename, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  } while (fd == -1 && errno == EEXIST);
+
+  return fd;
+}
+
+// An output file that is only written where it differs from the file it replaces.
+// While the output matches the start of the previous file nothing is written; the
+// temporary file is created at the first difference, starting with the bytes that
+// matched
+typedef struct OutputFile
+{
+  int dirfd;
+  const char *filename;
+  char tmp_filename[PATH_MAX + 64];
+  int fd; // -1 until the temporary file is created
+  bool created; // the temporary file exists
+  const char *previous; // mapped content of the file it replaces, NULL when not compared
+  size_t previous_size;
+  struct stat previous_stat;
+  size_t matched; // bytes of the output equal to the start of previous
+} OutputFile;
+
+// Prepares an output file of the directory dirfd. With compare, the file it replaces
+// is mapped so an identical output is not written
+void init_output_file(OutputFile *output, int dirfd, const char *filename, bool compare)
+{
+  int fd;
+
+  output->dirfd = dirfd;
+  output->filename = filename;
+  output->fd = -1;
+  output->created = false;
+  output->previous = NULL;
+  output->previous_size = 0;
+  output->matched = 0;
+
+  if (!compare)
+    return;
+
+  // A missing or empty file is never the output, so it is not compared
+  fd = openat(dirfd, filename, O_RDONLY);
+
+  if (fd == -1)
+    return;
+
+  if (fstat(fd, &output->previous_stat) == 0 && S_ISREG(output->previous_stat.st_mode) &&
+      output->previous_stat.st_size > 0)
+  {
+    void *map = mmap(NULL, output->previous_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map != MAP_FAILED)
+    {
+      output->previous = (const char *)map;
+      output->previous_size = output->previous_stat.st_size;
+    }
+  }
+
+  close(fd);
+}
+
+// Creates the temporary file of an output file, writing the bytes that matched the previous file
+bool open_output_file(OutputFile *output)
+{
+  output->fd = create_temp_file(output->dirfd, output->filename, output->tmp_filename, sizeof(output->tmp_filename));
+
+  if (output->fd == -1)
+    return false;
+
+  output->created = true;
+
+  return write_fd(&output->fd, output->previous, output->matched);
+}
+
+// Writes to an output file. ctx points to the OutputFile
+bool write_output_file(void *ctx, const char *data, size_t size)
+{
+  OutputFile *output = (OutputFile *)ctx;
+
+  if (output->fd == -1)
+  {
+    if (output->previous_size - output->matched >= size &&
+        memcmp(output->previous + output->matched, data, size) == 0)
+    {
+      output->matched += size;
+      return true;
+    }
+
+    if (!open_output_file(output))
+      return false;
+  }
+
+  return write_fd(&output->fd, data, size);
+}
+
+// Replaces the file with the complete output, unless they are the same. The stat of
+// the file is stored in output_stat. Returns false on error
+bool finish_output_file(OutputFile *output, struct stat *output_stat, bool *unchanged)
+{
+  bool ret;
+
+  *unchanged = output->fd == -1 && output->previous != NULL && output->matched == output->previous_size;
+
+  if (*unchanged)
+  {
+    *output_stat = output->previous_stat;
+    return true;
+  }
+
+  // The output is shorter than the previous file
+  if (output->fd == -1 && !open_output_file(output))
+    return false;
+
+  ret = fstat(output->fd, output_stat) == 0;
+  ret = close(output->fd) == 0 && ret;
+  output->fd = -1;
+
+  return ret && renameat(output->dirfd, output->tmp_filename, output->dirfd, output->filename) == 0;
+}
+
+// Releases an output file. The temporary file is removed when the output failed
+void fini_output_file(OutputFile *output, bool succ)
+{
+  if (output->fd != -1)
+    close(output->fd);
+
+  if (!succ && output->created)
+    unlinkat(output->dirfd, output->tmp_filename, 0);
+
+  if (output->previous != NULL)
+    munmap((void *)output->previous, output->previous_size);
+}
+
+// Points the reusable parser of a thread to a file, creating it for the first file
+bool load_parser(Parser **parser, int dirfd, const char *jack_file, PARSER_MODE mode, FILE *log)
+{
+  if (*parser == NULL)
+  {
+    *parser = init_parser(dirfd, jack_file, mode, log);
+    return *parser != NULL;
+  }
+
+  return reset_parser(*parser, dirfd, jack_file, log);
+}
+
+// Analyzes a jack file as analyze_file does, timing its phases and recording
+// its output size in file_stats
+bool process_file(int dirfd, const char *jack_file, const AnalyzeOptions *options, Parser **reused,
+                  FILE *log, FileStats *file_stats)
 {
   int i = 0;
   const char *current_char = jack_file;
-  char input_filename[MAX_FILENAME_LENGTH + 1];
-  char xml_filename[MAX_FILENAME_LENGTH + 1];
+  char input_filename[PATH_MAX];
+  char output_filename[PATH_MAX + 8];
   const char *extension = strrchr(jack_file, '.');
 
-  FILE *ast_stream, *xml_out;
-  char *ast_buf;
-  size_t ast_size;
+  struct stat jack_stat;
+  struct stat output_stat;
+  Writer writer;
   Parser *parser;
+  double start;
+  const char *output_extension = format_extensions[options->format];
+  OutputFile output;
+  bool unchanged;
   bool ret;
 
+  if (extension == NULL || extension - jack_file >= PATH_MAX)
+  {
+    fprintf(log, "Invalid file %s: Path is too long\n", jack_file);
+    return false;
+  }
+
   while (current_char != extension)
   {
     input_filename[i++] = *current_char;
@@ -39,55 +253,139 @@ bool analyze_file(const char *jack_file)
 
   input_filename[i] = '\0';
 
-  parser = init_parser(jack_file);
+  snprintf(output_filename, sizeof(output_filename), "%s.%s", input_filename, output_extension);
 
-  if (parser == NULL)
+  if (options->cache != NULL && !options->check)
   {
-    fprintf(stderr, "Fail to initialize parser for file %s\n", jack_file);
-    return false;
+    // The stat is taken before reading, so a change made while the file is
+    // analyzed makes the next run look at the content again
+    if (fstatat(dirfd, jack_file, &jack_stat, 0) != 0)
+    {
+      fprintf(log, "Failed to open %s: %s\n", jack_file, strerror(errno));
+      return false;
+    }
+
+    if (cache_is_fresh(options->cache, jack_file, &jack_stat, output_filename))
+    {
+      file_stats->cached = true;
+      return true;
+    }
   }
 
-  ast_stream = open_memstream(&ast_buf, &ast_size);
+  start = stats_clock();
+  ret = load_parser(reused, dirfd, jack_file,
+                    options->pipeline ? PIPELINED_PARSER_MODE : PRETOKENIZED_PARSER_MODE, log);
+  file_stats->seconds[LEX_PHASE] = stats_clock() - start;
 
-  if (ast_stream == NULL)
+  if (!ret)
   {
-    fprintf(stderr, "Fail to create buffer for AST: %s\n", strerror(errno));
-    fini_parser(parser);
+    fprintf(log, "Fail to initialize parser for file %s\n", jack_file);
     return false;
   }
 
+  parser = *reused;
+  parser_build_tree(parser, !options->check);
+  parser_set_max_depth(parser, options->max_depth);
+
   // Parse file
-  ret = compileClass(parser, ast_stream);
+  start = stats_clock();
+  ret = compileClass(parser);
+  file_stats->seconds[PARSE_PHASE] = stats_clock() - start;
 
-  fclose(ast_stream);
+  if (options->stats != NULL)
+    measure_parser(file_stats, parser);
 
   if (!ret)
   {
-    fprintf(stderr, "Fail to parse file %s\n", jack_file);
-    free(ast_buf);
-    fini_parser(parser);
+    fprintf(log, "Fail to parse file %s\n", jack_file);
     return false;
   }
 
-  // Create output xml file
-  snprintf(xml_filename, sizeof(xml_filename), "%s.%s", input_filename, JACK_XML_EXTENSION);
+  if (options->check)
+    return true;
 
-  xml_out = fopen(xml_filename, "w");
+  // Create output file. The syntax tree is streamed to a temporary file
+  // which replaces the output file only once it is complete. When the output
+  // is compared with the existing file, the temporary file is created lazily
+  start = stats_clock();
+  init_output_file(&output, dirfd, output_filename, options->skip_unchanged);
 
-  if (xml_out == NULL)
+  if (output.previous == NULL && !open_output_file(&output))
   {
-    fprintf(stderr, "Fail to create xml file %s: %s", xml_filename, strerror(errno));
-    free(ast_buf);
-    fini_parser(parser);
+    fprintf(log, "Fail to create %s file %s: %s\n", output_extension, output_filename, strerror(errno));
+    fini_output_file(&output, false);
     return false;
   }
 
-  fwrite(ast_buf, sizeof(char), ast_size, xml_out);
-  fclose(xml_out);
-  free(ast_buf);
-  fini_parser(parser);
+  init_writer(&writer, write_output_file, &output);
 
-  return true;
+  if (options->format == BINARY_OUTPUT_FORMAT)
+    ret = emit_binary(parser_ast(parser), &writer);
+  else
+    ret = emit_tree(parser_ast(parser), format_emitters[options->format], &writer);
+
+  ret = ret && writer_flush(&writer);
+  ret = ret && finish_output_file(&output, &output_stat, &unchanged);
+
+  file_stats->seconds[WRITE_PHASE] = stats_clock() - start;
+  file_stats->output_bytes = ret ? output_stat.st_size : 0;
+  file_stats->unchanged = ret && unchanged;
+
+  if (ret && options->cache != NULL)
+  {
+    size_t source_size;
+    const char *source = parser_source(parser, &source_size);
+
+    cache_update(options->cache, jack_file, &jack_stat, hash_content(source, source_size), &output_stat);
+  }
+
+  if (!ret)
+    fprintf(log, "Fail to write %s file %s: %s\n", output_extension, output_filename, strerror(errno));
+
+  fini_output_file(&output, ret);
+
+  return ret;
+}
+
+bool analyze_file(int dirfd, const char *jack_file, const AnalyzeOptions *options, Parser **reused, FILE *log)
+{
+  FileStats file_stats;
+  bool ret;
+
+  memset(&file_stats, 0, sizeof(file_stats));
+  ret = process_file(dirfd, jack_file, options, reused, log, &file_stats);
+
+  if (options->stats != NULL)
+  {
+    file_stats.succ = ret;
+    stats_add_file(options->stats, jack_file, &file_stats);
+  }
+
+  return ret;
+}
+
+bool analyze_source(const char *source, size_t size, const AnalyzeOptions *options, Writer *out, Parser **reused,
+                    FILE *log)
+{
+  if (*reused == NULL)
+    *reused = init_parser_buffer(source, size, PRETOKENIZED_PARSER_MODE, log);
+  else if (!reset_parser_buffer(*reused, source, size, log))
+    return false;
+
+  if (*reused == NULL)
+  {
+    fprintf(log, "Fail to initialize parser\n");
+    return false;
+  }
+
+  // A --check file request may have turned the tree off on the reused parser
+  parser_build_tree(*reused, true);
+  parser_set_max_depth(*reused, options->max_depth);
+
+  if (!compileClass(*reused))
+    return false;
+
+  return emit_xml(parser_ast(*reused), out) && writer_flush(out);
 }
 
 bool is_file_jack(const char *filename)
@@ -100,56 +398,651 @@ bool is_file_jack(const char *filename)
   return strcmp(file_extension, JACK_FILE_EXTENSION) == 0;
 }
 
-bool analyze_dir()
+// A jack file of a directory and the result of analyzing it
+typedef struct JackFile
+{
+  char *name;
+  off_t size;
+  bool succ;
+  // Errors of the file, buffered when files are analyzed concurrently
+  char *log;
+  size_t log_size;
+} JackFile;
+
+// Files of a directory shared by the worker threads
+typedef struct DirJobs
+{
+  int dirfd;
+  const AnalyzeOptions *options;
+  JackFile *files;
+  // Files sorted by decreasing size. Workers take the next file from this
+  // order, so the largest files start first and the small ones fill the gaps
+  JackFile **order;
+  size_t count;
+  atomic_size_t next;
+} DirJobs;
+
+int compare_file_names(const void *a, const void *b)
+{
+  return strcmp(((const JackFile *)a)->name, ((const JackFile *)b)->name);
+}
+
+int compare_file_sizes(const void *a, const void *b)
+{
+  off_t size_a = (*(JackFile *const *)a)->size;
+  off_t size_b = (*(JackFile *const *)b)->size;
+
+  return (size_a < size_b) - (size_a > size_b);
+}
+
+// Analyzes a file keeping its errors in memory
+void analyze_job(int dirfd, const AnalyzeOptions *options, Parser **parser, JackFile *file)
+{
+  FILE *log = open_memstream(&file->log, &file->log_size);
+
+  if (log == NULL)
+  {
+    file->log = NULL;
+    file->succ = analyze_file(dirfd, file->name, options, parser, stderr);
+    return;
+  }
+
+  file->succ = analyze_file(dirfd, file->name, options, parser, log);
+  fclose(log);
+}
+
+// Worker thread. Takes files until there are none left
+void *analyze_worker(void *arg)
+{
+  DirJobs *jobs = (DirJobs *)arg;
+  Parser *parser = NULL;
+  size_t i;
+
+  while ((i = atomic_fetch_add(&jobs->next, 1)) < jobs->count)
+  {
+    analyze_job(jobs->dirfd, jobs->options, &parser, jobs->order[i]);
+  }
+
+  if (parser != NULL)
+    fini_parser(parser);
+
+  return NULL;
+}
+
+void free_jack_files(JackFile *files, size_t count)
+{
+  size_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    free(files[i].name);
+    free(files[i].log);
+  }
+
+  free(files);
+}
+
+// Lists the jack files of the directory dirfd, sorted by name
+bool list_jack_files(int dirfd, JackFile **files, size_t *count)
 {
-  DIR *directory = opendir(".");
+  // The directory stream takes ownership of its descriptor
+  int list_fd = dup(dirfd);
+  DIR *directory = list_fd == -1 ? NULL : fdopendir(list_fd);
   struct dirent *dir_entry;
-  int total_jack_files = 0;
-  int succ_jack_files = 0;
+  JackFile *list = NULL;
+  size_t capacity = 0;
+  size_t total = 0;
 
   if (directory == NULL)
   {
-    fprintf(stderr, "Failed to open directory\n");
+    fprintf(stderr, "Failed to open directory: %s\n", strerror(errno));
+
+    if (list_fd != -1)
+      close(list_fd);
+
     return false;
   }
 
+  // The duplicated descriptor shares its offset with dirfd
+  rewinddir(directory);
+
   while ((dir_entry = readdir(directory)) != NULL)
   {
-    if (dir_entry->d_type != DT_REG)
-      continue;
+    struct stat file_stat;
 
     if (!is_file_jack(dir_entry->d_name))
       continue;
 
-    total_jack_files++;
+    if (fstatat(dirfd, dir_entry->d_name, &file_stat, 0) != 0 || !S_ISREG(file_stat.st_mode))
+      continue;
+
+    if (total == capacity)
+    {
+      JackFile *new_list;
+
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      new_list = (JackFile *)realloc(list, capacity * sizeof(JackFile));
+
+      if (new_list == NULL)
+        break;
+
+      list = new_list;
+    }
+
+    list[total].name = strdup(dir_entry->d_name);
+    list[total].size = file_stat.st_size;
+    list[total].succ = false;
+    list[total].log = NULL;
+    list[total].log_size = 0;
 
-    if (analyze_file(dir_entry->d_name))
+    if (list[total].name == NULL)
+      break;
+
+    total++;
+  }
+
+  closedir(directory);
+
+  if (dir_entry != NULL)
+  {
+    fprintf(stderr, "Out of memory while listing directory\n");
+    free_jack_files(list, total);
+    return false;
+  }
+
+  qsort(list, total, sizeof(JackFile), compare_file_names);
+
+  *files = list;
+  *count = total;
+
+  return true;
+}
+
+// Prints the buffered errors of the analyzed files followed by a summary.
+// Returns true if every file was analyzed
+bool report_jack_files(const JackFile *files, size_t count)
+{
+  size_t succ_jack_files = 0;
+  size_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (files[i].log != NULL)
+      fwrite(files[i].log, sizeof(char), files[i].log_size, stderr);
+
+    if (files[i].succ)
       succ_jack_files++;
   }
 
-  if (total_jack_files == 0)
+  if (count == 0)
   {
     fprintf(stderr, "No jack files found in directory\n");
   }
   else
   {
-    fprintf(stderr, "Parsed %d out of %d files\n", succ_jack_files, total_jack_files);
+    fprintf(stderr, "Parsed %zu out of %zu files\n", succ_jack_files, count);
   }
 
-  return total_jack_files == succ_jack_files;
+  return succ_jack_files == count;
+}
+
+// Analyzes every jack file of the directory dirfd using num_threads worker threads.
+// Errors are reported in file name order regardless of the order in which files finish.
+bool analyze_dir(int dirfd, const AnalyzeOptions *options, int num_threads)
+{
+  DirJobs jobs;
+  pthread_t *threads;
+  int started = 0;
+  bool ret;
+  size_t i;
+
+  if (!list_jack_files(dirfd, &jobs.files, &jobs.count))
+    return false;
+
+  jobs.dirfd = dirfd;
+  jobs.options = options;
+
+  if (num_threads > 1 && jobs.count > 1)
+  {
+    if ((size_t)num_threads > jobs.count)
+      num_threads = jobs.count;
+
+    jobs.order = (JackFile **)malloc(jobs.count * sizeof(JackFile *));
+    threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+
+    if (jobs.order == NULL || threads == NULL)
+    {
+      fprintf(stderr, "Out of memory while starting workers\n");
+      free(jobs.order);
+      free(threads);
+      free_jack_files(jobs.files, jobs.count);
+      return false;
+    }
+
+    for (i = 0; i < jobs.count; i++)
+      jobs.order[i] = &jobs.files[i];
+
+    qsort(jobs.order, jobs.count, sizeof(JackFile *), compare_file_sizes);
+    atomic_init(&jobs.next, 0);
+
+    for (started = 0; started < num_threads - 1; started++)
+    {
+      if (pthread_create(&threads[started], NULL, analyze_worker, &jobs) != 0)
+        break;
+    }
+
+    // The calling thread works too, which also covers a failure to start threads
+    analyze_worker(&jobs);
+
+    while (started > 0)
+      pthread_join(threads[--started], NULL);
+
+    free(threads);
+    free(jobs.order);
+  }
+  else
+  {
+    Parser *parser = NULL;
+
+    for (i = 0; i < jobs.count; i++)
+      jobs.files[i].succ = analyze_file(dirfd, jobs.files[i].name, options, &parser, stderr);
+
+    if (parser != NULL)
+      fini_parser(parser);
+  }
+
+  ret = report_jack_files(jobs.files, jobs.count);
+
+  free_jack_files(jobs.files, jobs.count);
+
+  return ret;
+}
+
+// A directory or a jack file found by the recursive walk
+typedef struct WalkTask
+{
+  bool is_dir;
+  // Path relative to the root directory. Directory paths end with a slash,
+  // except the root itself which is empty
+  char *path;
+} WalkTask;
+
+// State shared by the workers of a recursive walk
+typedef struct TreeWalk
+{
+  int dirfd;
+  const AnalyzeOptions *options;
+  Parser **parsers; // parser reused by each worker
+  pthread_mutex_t lock; // guards the analyzed files
+  JackFile *files;
+  size_t count;
+  size_t capacity;
+  atomic_bool failed; // a directory could not be read
+} TreeWalk;
+
+bool push_walk_task(Scheduler *scheduler, int worker, bool is_dir, const char *dir_path, const char *name)
+{
+  WalkTask *task = (WalkTask *)malloc(sizeof(WalkTask));
+  size_t dir_length = strlen(dir_path);
+  size_t name_length = strlen(name);
+
+  if (task == NULL)
+    return false;
+
+  // Room for the trailing slash of directories
+  task->path = (char *)malloc(dir_length + name_length + 2);
+
+  if (task->path == NULL)
+  {
+    free(task);
+    return false;
+  }
+
+  memcpy(task->path, dir_path, dir_length);
+  memcpy(task->path + dir_length, name, name_length);
+
+  if (is_dir && name_length > 0)
+    task->path[dir_length + name_length++] = '/';
+
+  task->path[dir_length + name_length] = '\0';
+  task->is_dir = is_dir;
+
+  if (dir_length + name_length >= PATH_MAX || !scheduler_push(scheduler, worker, task))
+  {
+    free(task->path);
+    free(task);
+    return false;
+  }
+
+  return true;
+}
+
+// Scans a directory of the walk. Subdirectories and jack files become new tasks
+// of the worker, so other workers can steal them while the scan goes on
+void walk_dir(Scheduler *scheduler, int worker, TreeWalk *walk, const char *path)
+{
+  int fd = path[0] == '\0' ? dup(walk->dirfd) : openat(walk->dirfd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+  DIR *directory = fd == -1 ? NULL : fdopendir(fd);
+  struct dirent *dir_entry;
+
+  if (directory == NULL)
+  {
+    fprintf(stderr, "Failed to open directory %s: %s\n", path[0] == '\0' ? "." : path, strerror(errno));
+    atomic_store(&walk->failed, true);
+
+    if (fd != -1)
+      close(fd);
+
+    return;
+  }
+
+  rewinddir(directory);
+
+  while ((dir_entry = readdir(directory)) != NULL)
+  {
+    const char *name = dir_entry->d_name;
+    unsigned char type = dir_entry->d_type;
+    struct stat link_stat;
+    struct stat file_stat;
+
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+      continue;
+
+    // Classify entries the directory does not type. Links are only
+    // followed to files, so the walk can not loop
+    if (type == DT_UNKNOWN || type == DT_LNK)
+    {
+      if (fstatat(fd, name, &link_stat, AT_SYMLINK_NOFOLLOW) != 0)
+        continue;
+
+      if (S_ISLNK(link_stat.st_mode))
+        type = fstatat(fd, name, &file_stat, 0) == 0 && S_ISREG(file_stat.st_mode) ? DT_REG : DT_LNK;
+      else if (S_ISDIR(link_stat.st_mode))
+        type = DT_DIR;
+      else if (S_ISREG(link_stat.st_mode))
+        type = DT_REG;
+      else
+        type = DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR || (type == DT_REG && is_file_jack(name)))
+    {
+      if (!push_walk_task(scheduler, worker, type == DT_DIR, path, name))
+      {
+        fprintf(stderr, "Failed to schedule %s%s\n", path, name);
+        atomic_store(&walk->failed, true);
+      }
+    }
+  }
+
+  closedir(directory);
+}
+
+// Analyzes a jack file of the walk and keeps the result
+void walk_file(TreeWalk *walk, int worker, char *path)
+{
+  JackFile file = {path, 0, false, NULL, 0};
+
+  analyze_job(walk->dirfd, walk->options, &walk->parsers[worker], &file);
+
+  pthread_mutex_lock(&walk->lock);
+
+  if (walk->count == walk->capacity)
+  {
+    size_t new_capacity = walk->capacity == 0 ? 64 : walk->capacity * 2;
+    JackFile *new_files = (JackFile *)realloc(walk->files, new_capacity * sizeof(JackFile));
+
+    if (new_files != NULL)
+    {
+      walk->files = new_files;
+      walk->capacity = new_capacity;
+    }
+  }
+
+  if (walk->count < walk->capacity)
+  {
+    walk->files[walk->count++] = file;
+  }
+  else
+  {
+    fprintf(stderr, "Out of memory while analyzing %s\n", path);
+    atomic_store(&walk->failed, true);
+    free(file.name);
+    free(file.log);
+  }
+
+  pthread_mutex_unlock(&walk->lock);
+}
+
+void run_walk_task(Scheduler *scheduler, int worker, void *arg)
+{
+  WalkTask *task = (WalkTask *)arg;
+  TreeWalk *walk = (TreeWalk *)scheduler_ctx(scheduler);
+
+  if (task->is_dir)
+  {
+    walk_dir(scheduler, worker, walk, task->path);
+    free(task->path);
+  }
+  else
+  {
+    // The result keeps the path
+    walk_file(walk, worker, task->path);
+  }
+
+  free(task);
+}
+
+// Analyzes every jack file under the directory dirfd using num_threads workers.
+// The walk runs on the workers too, so files are analyzed while it goes on.
+// Errors are reported in path order once every file is done.
+bool analyze_tree(int dirfd, const AnalyzeOptions *options, int num_threads)
+{
+  TreeWalk walk;
+  Scheduler *scheduler;
+  bool ret;
+  int i;
+
+  walk.dirfd = dirfd;
+  walk.options = options;
+  walk.files = NULL;
+  walk.count = 0;
+  walk.capacity = 0;
+  atomic_init(&walk.failed, false);
+  pthread_mutex_init(&walk.lock, NULL);
+
+  walk.parsers = (Parser **)calloc(num_threads, sizeof(Parser *));
+  scheduler = walk.parsers == NULL ? NULL : init_scheduler(num_threads, run_walk_task, &walk);
+
+  if (scheduler == NULL || !push_walk_task(scheduler, 0, true, "", ""))
+  {
+    fprintf(stderr, "Out of memory while starting workers\n");
+
+    if (scheduler != NULL)
+      fini_scheduler(scheduler);
+
+    free(walk.parsers);
+    pthread_mutex_destroy(&walk.lock);
+    return false;
+  }
+
+  scheduler_run(scheduler);
+  fini_scheduler(scheduler);
+  pthread_mutex_destroy(&walk.lock);
+
+  for (i = 0; i < num_threads; i++)
+  {
+    if (walk.parsers[i] != NULL)
+      fini_parser(walk.parsers[i]);
+  }
+
+  free(walk.parsers);
+
+  qsort(walk.files, walk.count, sizeof(JackFile), compare_file_names);
+
+  ret = report_jack_files(walk.files, walk.count) && !atomic_load(&walk.failed);
+
+  free_jack_files(walk.files, walk.count);
+
+  return ret;
+}
+
+// Opens a directory to resolve the paths of the files it contains
+int open_dir(const char *path)
+{
+  int dirfd = open(path, O_RDONLY | O_DIRECTORY);
+
+  if (dirfd == -1)
+    fprintf(stderr, "Failed to open directory %s: %s\n", path, strerror(errno));
+
+  return dirfd;
+}
+
+void print_usage()
+{
+  fprintf(stderr, "Usage: ./JackAnalyzer [-j threads] [-r] [--cache] [--check] [--pipeline]\n"
+                  "                      [--max-depth levels] [--format xml|compact-xml|json|binary]\n"
+                  "                      [--skip-unchanged] [--stats[=text|json]] [filename | directory]\n");
+  fprintf(stderr, "       ./JackAnalyzer [-j threads] --serve socket\n");
+  fprintf(stderr, "       ./JackAnalyzer --client socket [filename | -]\n");
 }
 
 int main(int argc, char *argv[])
 {
+  static const struct option long_options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {"recursive", no_argument, NULL, 'r'},
+    {"cache", no_argument, NULL, 'c'},
+    {"serve", required_argument, NULL, 'S'},
+    {"client", required_argument, NULL, 'C'},
+    {"check", no_argument, NULL, 'K'},
+    {"stats", optional_argument, NULL, 's'},
+    {"pipeline", no_argument, NULL, 'P'},
+    {"max-depth", required_argument, NULL, 'D'},
+    {"format", required_argument, NULL, 'F'},
+    {"skip-unchanged", no_argument, NULL, 'U'},
+    {NULL, 0, NULL, 0}
+  };
+
   struct stat input_path_stat;
+  char file_path[MAX_FILENAME_LENGTH + 1];
+  char dir_path[MAX_FILENAME_LENGTH + 1];
+  const char *file_name = NULL;
+  const char *dir_name = ".";
+  AnalyzeOptions options = {NULL};
+  Cache cache;
+  Stats stats;
+  STATS_FORMAT stats_format = TEXT_STATS_FORMAT;
+  bool use_stats = false;
+  long depth;
+  int format;
+  char cache_version[64];
+  int num_threads = 1;
+  bool recursive = false;
+  bool use_cache = false;
+  const char *serve_socket = NULL;
+  const char *client_socket = NULL;
+  int dirfd;
+  bool ret;
+  int opt;
+
+  options.max_depth = PARSER_DEFAULT_MAX_DEPTH;
+
+  while ((opt = getopt_long(argc, argv, "j:rc", long_options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 'j':
+        num_threads = atoi(optarg);
+
+        if (num_threads < 1)
+        {
+          fprintf(stderr, "Invalid number of threads %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'r':
+        recursive = true;
+        break;
+      case 'c':
+        use_cache = true;
+        break;
+      case 'S':
+        serve_socket = optarg;
+        break;
+      case 'C':
+        client_socket = optarg;
+        break;
+      case 'K':
+        options.check = true;
+        break;
+      case 'P':
+        options.pipeline = true;
+        break;
+      case 'D':
+        depth = atol(optarg);
+
+        if (depth < 1 || depth > UINT32_MAX)
+        {
+          fprintf(stderr, "Invalid nesting depth %s\n", optarg);
+          return 1;
+        }
+
+        options.max_depth = depth;
+        break;
+      case 'U':
+        options.skip_unchanged = true;
+        break;
+      case 'F':
+        for (format = 0; format <= BINARY_OUTPUT_FORMAT; format++)
+        {
+          if (strcmp(optarg, format_names[format]) == 0)
+            break;
+        }
+
+        if (format > BINARY_OUTPUT_FORMAT)
+        {
+          fprintf(stderr, "Invalid output format %s. Must be xml, compact-xml, json or binary\n", optarg);
+          return 1;
+        }
+
+        options.format = format;
+        break;
+      case 's':
+        use_stats = true;
 
-  if (argc > 2)
+        if (optarg == NULL || strcmp(optarg, "text") == 0)
+          stats_format = TEXT_STATS_FORMAT;
+        else if (strcmp(optarg, "json") == 0)
+          stats_format = JSON_STATS_FORMAT;
+        else
+        {
+          fprintf(stderr, "Invalid statistics format %s\n", optarg);
+          return 1;
+        }
+        break;
+      default:
+        print_usage();
+        return 1;
+    }
+  }
+
+  argc -= optind;
+  argv += optind - 1;
+
+  if (argc > 1 || (serve_socket != NULL && (argc > 0 || client_socket != NULL)))
   {
-    fprintf(stderr, "Usage: ./parser [filename | directory]\n");
+    print_usage();
     return 1;
   }
 
-  if (argc == 2)
+  if (serve_socket != NULL)
+    return serve(serve_socket, num_threads, &options) ? 0 : 1;
+
+  if (client_socket != NULL)
+    return run_client(client_socket, argc == 1 ? argv[1] : "-") ? 0 : 1;
+
+  if (argc == 1)
   {
     if (stat(argv[1], &input_path_stat) != 0)
     {
@@ -157,14 +1050,15 @@ int main(int argc, char *argv[])
       return 1;
     }
 
+    if (strlen(argv[1]) > MAX_FILENAME_LENGTH)
+    {
+      fprintf(stderr, "Invalid file %s: Path is too long\n", argv[1]);
+      return 1;
+    }
+
     if (S_ISREG(input_path_stat.st_mode))
     {
       // Check if file is jack
-      char file_path[MAX_FILENAME_LENGTH + 1];
-      char dir_path[MAX_FILENAME_LENGTH + 1];
-      char *file_name;
-      char *dir_name;
-
       strcpy(file_path, argv[1]);
 
       file_name = basename(file_path);
@@ -178,34 +1072,74 @@ int main(int argc, char *argv[])
       strcpy(dir_path, argv[1]);
 
       dir_name = dirname(dir_path);
-
-      // Switch to directory
-      if (chdir(dir_name) != 0)
-      {
-        fprintf(stderr, "Failed to open directory %s: %s\n", dir_name, strerror(errno));
-        return 1;
-      }
-
-      if (analyze_file(file_name) == false)
-        return 1;
     }
     else if (S_ISDIR(input_path_stat.st_mode))
     {
-      // Switch to directory
-      if (chdir(argv[1]) != 0)
-      {
-        fprintf(stderr, "Failed to open directory %s: %s\n", argv[1], strerror(errno));
-        return 1;
-      }
-
-      if (analyze_dir() == false)
-        return 1;
+      dir_name = argv[1];
+    }
+    else
+    {
+      fprintf(stderr, "Invalid file %s: Must provide a file or a directory\n", argv[1]);
+      return 1;
     }
   }
-  else if (analyze_dir() == false)
-  {
+
+  dirfd = open_dir(dir_name);
+
+  if (dirfd == -1)
     return 1;
+
+  // Checking writes no xml files, so there is nothing to cache
+  if (use_cache && !options.check)
+  {
+    // Files written in another format are not valid outputs, and files that
+    // passed with a higher nesting limit may fail with a lower one
+    snprintf(cache_version, sizeof(cache_version), "%s %s %u", ANALYZER_VERSION, format_names[options.format],
+             options.max_depth);
+
+    init_cache(&cache, dirfd, cache_version);
+    options.cache = &cache;
+  }
+
+  if (use_stats)
+  {
+    init_stats(&stats);
+    options.stats = &stats;
+  }
+
+  if (file_name != NULL)
+  {
+    Parser *parser = NULL;
+
+    ret = analyze_file(dirfd, file_name, &options, &parser, stderr);
+
+    if (parser != NULL)
+      fini_parser(parser);
+  }
+  else if (recursive)
+  {
+    ret = analyze_tree(dirfd, &options, num_threads);
   }
+  else
+  {
+    ret = analyze_dir(dirfd, &options, num_threads);
+  }
+
+  if (options.cache != NULL)
+  {
+    if (!save_cache(&cache))
+      fprintf(stderr, "Failed to write cache %s: %s\n", CACHE_FILENAME, strerror(errno));
+
+    fini_cache(&cache);
+  }
+
+  if (options.stats != NULL)
+  {
+    print_stats(&stats, stats_format, stdout);
+    fini_stats(&stats);
+  }
+
+  close(dirfd);
 
-  return 0;
-}
\ No newline at end of file
+  return ret ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "parser.h"
+#include "emitter.h"
+#include "cache.h"
+#include "stats.h"
+
+// Identifies the output of the analyzer in the cache. Must change whenever
+// the xml written for a jack file changes
+#define ANALYZER_VERSION "1.0"
+
+// Format of the files written for the analyzed jack files
+typedef enum OUTPUT_FORMAT
+{
+  XML_OUTPUT_FORMAT,
+  COMPACT_XML_OUTPUT_FORMAT, // xml without indentation or newlines
+  JSON_OUTPUT_FORMAT,
+  BINARY_OUTPUT_FORMAT // see jackast.h
+} OUTPUT_FORMAT;
+
+// Settings of a run shared by every analyzed file
+typedef struct AnalyzeOptions
+{
+  Cache *cache; // NULL when the cache is disabled
+  bool check; // only check the syntax, no xml file is written
+  Stats *stats; // NULL when no statistics are collected
+  bool pipeline; // lex every file on a thread of its own while it is parsed
+  uint32_t max_depth; // nesting limit of expressions and statements
+  OUTPUT_FORMAT format;
+  bool skip_unchanged; // output files that would not change are not rewritten
+} AnalyzeOptions;
+
+// Writes to a file descriptor, retrying short writes. ctx points to the descriptor
+bool write_fd(void *ctx, const char *data, size_t size);
+
+// Checks whether a file name has the jack extension
+bool is_file_jack(const char *filename);
+
+// Parses a jack file of the directory dirfd and writes its syntax tree to a xml
+// json or binary file with the same name next to it. jack_file may be a path inside the directory.
+// Files whose output file is still valid according to the cache are skipped.
+// *parser is reset for the file, or created if NULL, and is kept for the next
+// file of the thread. Every error is reported to log
+bool analyze_file(int dirfd, const char *jack_file, const AnalyzeOptions *options, Parser **parser, FILE *log);
+
+// Parses a jack class held in memory and writes its syntax tree as xml to out.
+// The writer is flushed. *parser is reused as in analyze_file. Every error is reported to log
+bool analyze_source(const char *source, size_t size, const AnalyzeOptions *options, Writer *out, Parser **parser,
+                    FILE *log);
+
+#endif
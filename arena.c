@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Every allocation is aligned to this boundary
+#define ARENA_ALIGNMENT 16
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct ArenaChunk
+{
+  ArenaChunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+};
+
+// Initializes an empty arena. Chunks are allocated on demand
+void init_arena(Arena *arena, size_t chunk_size)
+{
+  arena->chunks = NULL;
+  arena->spare = NULL;
+  arena->chunk_size = chunk_size;
+  arena->last = NULL;
+}
+
+// Adds a chunk with room for at least size bytes. Spare chunks are used first
+ArenaChunk *add_chunk(Arena *arena, size_t size)
+{
+  size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+  ArenaChunk **spare = &arena->spare;
+  ArenaChunk *chunk;
+
+  while (*spare != NULL && (*spare)->size < size)
+    spare = &(*spare)->next;
+
+  if (*spare != NULL)
+  {
+    chunk = *spare;
+    *spare = chunk->next;
+  }
+  else
+  {
+    chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + chunk_size);
+
+    if (chunk == NULL)
+      return NULL;
+
+    chunk->size = chunk_size;
+  }
+
+  chunk->used = 0;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+
+  return chunk;
+}
+
+// Allocates memory from the arena. Returns NULL when out of memory
+void *arena_alloc(Arena *arena, size_t size)
+{
+  ArenaChunk *chunk = arena->chunks;
+  void *ptr;
+
+  size = ALIGN_UP(size);
+
+  if (chunk == NULL || chunk->size - chunk->used < size)
+  {
+    chunk = add_chunk(arena, size);
+
+    if (chunk == NULL)
+      return NULL;
+  }
+
+  ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->last = ptr;
+
+  return ptr;
+}
+
+// Grows an allocation, in place if it was the last one. Returns the (possibly moved)
+// allocation or NULL when out of memory, in which case the old allocation is kept
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+  ArenaChunk *chunk = arena->chunks;
+  void *new_ptr;
+
+  if (ptr == NULL)
+    return arena_alloc(arena, new_size);
+
+  if (ptr == arena->last)
+  {
+    size_t start = (unsigned char *)ptr - chunk->data;
+
+    if (chunk->size - start >= ALIGN_UP(new_size))
+    {
+      chunk->used = start + ALIGN_UP(new_size);
+      return ptr;
+    }
+  }
+
+  new_ptr = arena_alloc(arena, new_size);
+
+  if (new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size);
+
+  return new_ptr;
+}
+
+// Releases every allocation. The chunks are kept for the next allocations
+void arena_reset(Arena *arena)
+{
+  ArenaChunk *chunk = arena->chunks;
+
+  while (chunk != NULL)
+  {
+    ArenaChunk *next = chunk->next;
+
+    chunk->next = arena->spare;
+    arena->spare = chunk;
+    chunk = next;
+  }
+
+  arena->chunks = NULL;
+  arena->last = NULL;
+}
+
+// Frees all the memory of the arena
+void fini_arena(Arena *arena)
+{
+  ArenaChunk *chunk;
+
+  arena_reset(arena);
+
+  chunk = arena->spare;
+
+  while (chunk != NULL)
+  {
+    ArenaChunk *next = chunk->next;
+
+    free(chunk);
+    chunk = next;
+  }
+
+  init_arena(arena, arena->chunk_size);
+}
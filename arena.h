@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Bump allocator. Memory is handed out from large chunks and is only released
+// all at once, by resetting or freeing the arena.
+typedef struct Arena
+{
+  ArenaChunk *chunks; // most recent chunk first
+  ArenaChunk *spare; // chunks released by arena_reset, reused before allocating new ones
+  size_t chunk_size;
+  void *last; // last allocation, the only one that can grow in place
+} Arena;
+
+// Initializes an empty arena. Chunks are allocated on demand
+void init_arena(Arena *arena, size_t chunk_size);
+
+// Allocates memory from the arena. Returns NULL when out of memory
+void *arena_alloc(Arena *arena, size_t size);
+
+// Grows an allocation, in place if it was the last one. Returns the (possibly moved)
+// allocation or NULL when out of memory, in which case the old allocation is kept
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Releases every allocation. The chunks are kept for the next allocations, so an
+// arena reset between similar workloads stops allocating after the first ones
+void arena_reset(Arena *arena);
+
+// Frees all the memory of the arena
+void fini_arena(Arena *arena);
+
+#endif
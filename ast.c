@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Size of the arena chunks used by a tree
+#define AST_CHUNK_SIZE 65536
+
+// Initial number of nodes of a tree
+#define AST_INITIAL_NODES 1024
+
+// Initial depth of the stack of open nodes
+#define AST_INITIAL_DEPTH 64
+
+// Gets the name of the grammar rule of a node kind
+const char *ast_kind_str(AST_KIND kind)
+{
+  switch (kind)
+  {
+    case CLASS_AST:
+      return "class";
+    case CLASS_VAR_DEC_AST:
+      return "classVarDec";
+    case SUBROUTINE_DEC_AST:
+      return "subroutineDec";
+    case PARAMETER_LIST_AST:
+      return "parameterList";
+    case SUBROUTINE_BODY_AST:
+      return "subroutineBody";
+    case VAR_DEC_AST:
+      return "varDec";
+    case STATEMENTS_AST:
+      return "statements";
+    case LET_STATEMENT_AST:
+      return "letStatement";
+    case IF_STATEMENT_AST:
+      return "ifStatement";
+    case WHILE_STATEMENT_AST:
+      return "whileStatement";
+    case DO_STATEMENT_AST:
+      return "doStatement";
+    case RETURN_STATEMENT_AST:
+      return "returnStatement";
+    case EXPRESSION_AST:
+      return "expression";
+    case TERM_AST:
+      return "term";
+    case EXPRESSION_LIST_AST:
+      return "expressionList";
+    default:
+      return "token";
+  }
+}
+
+// Initializes an empty tree for a source text
+void init_ast(Ast *ast, const char *source)
+{
+  ast->source = source;
+  ast->nodes = NULL;
+  ast->node_count = 0;
+  ast->node_capacity = 0;
+  ast->open = NULL;
+  ast->open_count = 0;
+  ast->open_capacity = 0;
+  ast->failed = false;
+  ast->discard = false;
+  init_arena(&ast->arena, AST_CHUNK_SIZE);
+}
+
+// Empties a tree for a new source text, keeping its arena chunks for reuse
+void reset_ast(Ast *ast, const char *source)
+{
+  // Nodes and the open stack live in the arena
+  arena_reset(&ast->arena);
+  ast->source = source;
+  ast->nodes = NULL;
+  ast->node_count = 0;
+  ast->node_capacity = 0;
+  ast->open = NULL;
+  ast->open_count = 0;
+  ast->open_capacity = 0;
+  ast->failed = false;
+}
+
+// Frees all the memory of a tree
+void fini_ast(Ast *ast)
+{
+  fini_arena(&ast->arena);
+  init_ast(ast, NULL);
+}
+
+// Appends a node and returns it, NULL when out of memory
+AstNode *add_node(Ast *ast, AST_KIND kind)
+{
+  AstNode *node;
+
+  if (ast->failed || ast->discard)
+    return NULL;
+
+  if (ast->node_count == ast->node_capacity)
+  {
+    uint32_t capacity = ast->node_capacity == 0 ? AST_INITIAL_NODES : ast->node_capacity * 2;
+    AstNode *nodes = arena_grow(&ast->arena, ast->nodes, ast->node_capacity * sizeof(AstNode), capacity * sizeof(AstNode));
+
+    if (nodes == NULL)
+    {
+      ast->failed = true;
+      return NULL;
+    }
+
+    ast->nodes = nodes;
+    ast->node_capacity = capacity;
+  }
+
+  node = &ast->nodes[ast->node_count];
+  node->kind = kind;
+  node->type = INVALID_TOKEN_TYPE;
+  node->id = 0;
+  node->end = ++ast->node_count;
+  node->offset = 0;
+  node->length = 0;
+
+  return node;
+}
+
+// Starts a grammar rule node. Every following node is a descendant until it is closed
+void ast_open(Ast *ast, AST_KIND kind)
+{
+  if (add_node(ast, kind) == NULL)
+    return;
+
+  if (ast->open_count == ast->open_capacity)
+  {
+    uint32_t capacity = ast->open_capacity == 0 ? AST_INITIAL_DEPTH : ast->open_capacity * 2;
+    uint32_t *open = arena_grow(&ast->arena, ast->open, ast->open_capacity * sizeof(uint32_t), capacity * sizeof(uint32_t));
+
+    if (open == NULL)
+    {
+      ast->failed = true;
+      return;
+    }
+
+    ast->open = open;
+    ast->open_capacity = capacity;
+  }
+
+  ast->open[ast->open_count++] = ast->node_count - 1;
+}
+
+// Ends the last grammar rule node that was opened
+void ast_close(Ast *ast)
+{
+  if (ast->failed || ast->discard || ast->open_count == 0)
+    return;
+
+  ast->nodes[ast->open[--ast->open_count]].end = ast->node_count;
+}
+
+// Adds a terminal token node
+void ast_token(Ast *ast, const Token *token)
+{
+  AstNode *node = add_node(ast, TOKEN_AST);
+
+  if (node == NULL)
+    return;
+
+  node->type = token->type;
+  node->id = token->type == KEYWORD_TOKEN_TYPE ? token->keyword : token->symbol;
+  node->offset = token->offset;
+  node->length = token->length;
+}
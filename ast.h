@@ -0,0 +1,80 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+#include "lexer.h"
+
+// Kinds of nodes of the syntax tree. Every grammar rule has a kind,
+// terminal tokens are TOKEN_AST nodes.
+typedef enum AST_KIND
+{
+  CLASS_AST,
+  CLASS_VAR_DEC_AST,
+  SUBROUTINE_DEC_AST,
+  PARAMETER_LIST_AST,
+  SUBROUTINE_BODY_AST,
+  VAR_DEC_AST,
+  STATEMENTS_AST,
+  LET_STATEMENT_AST,
+  IF_STATEMENT_AST,
+  WHILE_STATEMENT_AST,
+  DO_STATEMENT_AST,
+  RETURN_STATEMENT_AST,
+  EXPRESSION_AST,
+  TERM_AST,
+  EXPRESSION_LIST_AST,
+  TOKEN_AST
+} AST_KIND;
+
+// Nodes are stored in pre-order, so the descendants of node i are the nodes in
+// the index range [i + 1, end). Its first child is i + 1 (if i + 1 < end) and
+// the sibling that follows a child c is nodes[c].end.
+typedef struct AstNode
+{
+  uint8_t kind;  // AST_KIND
+  uint8_t type;  // TOKEN_TYPE of TOKEN_AST nodes
+  uint8_t id;    // KEYWORD or SYMBOL of TOKEN_AST nodes
+  uint32_t end;
+  uint32_t offset; // source slice of TOKEN_AST nodes
+  uint32_t length;
+} AstNode;
+
+typedef struct Ast
+{
+  const char *source; // text referenced by the token nodes
+  AstNode *nodes;
+  uint32_t node_count;
+  uint32_t node_capacity;
+  // nodes opened and not closed yet
+  uint32_t *open;
+  uint32_t open_count;
+  uint32_t open_capacity;
+  bool failed; // set when an allocation fails, the tree is incomplete
+  bool discard; // nodes are dropped, the parser only checks the syntax
+  Arena arena;
+} Ast;
+
+// Gets the name of the grammar rule of a node kind
+const char *ast_kind_str(AST_KIND kind);
+
+// Initializes an empty tree for a source text
+void init_ast(Ast *ast, const char *source);
+
+// Empties a tree for a new source text. The memory of the tree is kept for the new nodes
+void reset_ast(Ast *ast, const char *source);
+
+// Frees all the memory of a tree
+void fini_ast(Ast *ast);
+
+// Starts a grammar rule node. Every following node is a descendant until it is closed
+void ast_open(Ast *ast, AST_KIND kind);
+
+// Ends the last grammar rule node that was opened
+void ast_close(Ast *ast);
+
+// Adds a terminal token node
+void ast_token(Ast *ast, const Token *token);
+
+#endif
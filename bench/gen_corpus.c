@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+// POSIX
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Generates a corpus of syntactically valid jack classes for benchmarks. The
+ * output only depends on the options, so a corpus can be regenerated anywhere.
+ */
+
+#define DEFAULT_FILES 64
+#define DEFAULT_BYTES 65536
+#define DEFAULT_DEPTH 4
+#define DEFAULT_COMMENTS 20
+#define DEFAULT_STRINGS 10
+#define DEFAULT_SEED 1
+
+typedef struct Generator
+{
+  FILE *out;
+  uint64_t state; // xorshift64* state
+  int depth; // maximum nesting of statements and expressions
+  int comments; // percentage of statements preceded by a comment
+  int strings; // percentage of terms that are string literals
+} Generator;
+
+static const char *words[] = {
+  "alpha", "beta", "gamma", "delta", "score", "count", "index", "value", "left", "right",
+  "width", "height", "speed", "total", "limit", "offset", "result", "buffer", "cursor", "state"
+};
+
+static const char *types[] = {"int", "char", "boolean", "Array", "String"};
+
+// The parser only takes class names as return types
+static const char *return_types[] = {"Array", "String"};
+
+static const char *ops[] = {"+", "-", "*", "/", "&", "|", "<", ">", "="};
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+uint32_t next_random(Generator *gen)
+{
+  gen->state ^= gen->state >> 12;
+  gen->state ^= gen->state << 25;
+  gen->state ^= gen->state >> 27;
+
+  return (uint32_t)((gen->state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// Gets a number in [0, n)
+uint32_t random_below(Generator *gen, uint32_t n)
+{
+  return next_random(gen) % n;
+}
+
+bool chance(Generator *gen, int percent)
+{
+  return (int)random_below(gen, 100) < percent;
+}
+
+const char *random_word(Generator *gen)
+{
+  return words[random_below(gen, COUNT(words))];
+}
+
+void indent(Generator *gen, int level)
+{
+  fprintf(gen->out, "%*s", level * 4, "");
+}
+
+void generate_comment(Generator *gen, int level)
+{
+  int i;
+  int count = 2 + random_below(gen, 6);
+
+  indent(gen, level);
+
+  switch (random_below(gen, 3))
+  {
+    case 0:
+      fprintf(gen->out, "//");
+
+      for (i = 0; i < count; i++)
+        fprintf(gen->out, " %s", random_word(gen));
+
+      fprintf(gen->out, "\n");
+      break;
+    case 1:
+      fprintf(gen->out, "/*");
+
+      for (i = 0; i < count; i++)
+        fprintf(gen->out, " %s", random_word(gen));
+
+      fprintf(gen->out, " */\n");
+      break;
+    default:
+      fprintf(gen->out, "/**\n");
+
+      for (i = 0; i < count; i++)
+      {
+        indent(gen, level);
+        fprintf(gen->out, " * %s %s\n", random_word(gen), random_word(gen));
+      }
+
+      indent(gen, level);
+      fprintf(gen->out, " */\n");
+      break;
+  }
+}
+
+void maybe_comment(Generator *gen, int level)
+{
+  if (chance(gen, gen->comments))
+    generate_comment(gen, level);
+}
+
+void generate_expression(Generator *gen, int depth);
+
+void generate_expression_list(Generator *gen, int depth)
+{
+  int i;
+  int count = random_below(gen, 4);
+
+  for (i = 0; i < count; i++)
+  {
+    if (i > 0)
+      fprintf(gen->out, ", ");
+
+    generate_expression(gen, depth);
+  }
+}
+
+void generate_call(Generator *gen, int depth)
+{
+  switch (random_below(gen, 3))
+  {
+    case 0:
+      fprintf(gen->out, "%s(", random_word(gen));
+      break;
+    case 1:
+      fprintf(gen->out, "%s.%s(", random_word(gen), random_word(gen));
+      break;
+    default:
+      fprintf(gen->out, "Output.print%s(", random_word(gen));
+      break;
+  }
+
+  generate_expression_list(gen, depth - 1);
+  fprintf(gen->out, ")");
+}
+
+void generate_term(Generator *gen, int depth)
+{
+  static const char *keywords[] = {"true", "false", "null", "this"};
+  int i;
+  int count;
+
+  if (chance(gen, gen->strings))
+  {
+    count = 1 + random_below(gen, 8);
+    fprintf(gen->out, "\"");
+
+    for (i = 0; i < count; i++)
+      fprintf(gen->out, "%s%s", i == 0 ? "" : " ", random_word(gen));
+
+    fprintf(gen->out, "\"");
+    return;
+  }
+
+  switch (depth > 0 ? random_below(gen, 8) : random_below(gen, 3))
+  {
+    case 0:
+      fprintf(gen->out, "%u", random_below(gen, 32768));
+      break;
+    case 1:
+      fprintf(gen->out, "%s", random_word(gen));
+      break;
+    case 2:
+      fprintf(gen->out, "%s", keywords[random_below(gen, COUNT(keywords))]);
+      break;
+    case 3:
+      fprintf(gen->out, "%s[", random_word(gen));
+      generate_expression(gen, depth - 1);
+      fprintf(gen->out, "]");
+      break;
+    case 4:
+    case 5:
+      generate_call(gen, depth);
+      break;
+    case 6:
+      fprintf(gen->out, "(");
+      generate_expression(gen, depth - 1);
+      fprintf(gen->out, ")");
+      break;
+    default:
+      fprintf(gen->out, "%s", random_below(gen, 2) == 0 ? "-" : "~");
+      generate_term(gen, depth - 1);
+      break;
+  }
+}
+
+void generate_expression(Generator *gen, int depth)
+{
+  int i;
+  int count = random_below(gen, 3);
+
+  generate_term(gen, depth);
+
+  for (i = 0; i < count; i++)
+  {
+    fprintf(gen->out, " %s ", ops[random_below(gen, COUNT(ops))]);
+    generate_term(gen, depth);
+  }
+}
+
+void generate_statements(Generator *gen, int level, int depth);
+
+void generate_statement(Generator *gen, int level, int depth)
+{
+  maybe_comment(gen, level);
+  indent(gen, level);
+
+  switch (depth > 0 ? random_below(gen, 6) : random_below(gen, 3))
+  {
+    case 0:
+    case 1:
+      fprintf(gen->out, "let %s", random_word(gen));
+
+      if (chance(gen, 25))
+      {
+        fprintf(gen->out, "[");
+        generate_expression(gen, depth);
+        fprintf(gen->out, "]");
+      }
+
+      fprintf(gen->out, " = ");
+      generate_expression(gen, gen->depth);
+      fprintf(gen->out, ";\n");
+      break;
+    case 2:
+      fprintf(gen->out, "do ");
+      generate_call(gen, gen->depth);
+      fprintf(gen->out, ";\n");
+      break;
+    case 3:
+    case 4:
+      fprintf(gen->out, "if (");
+      generate_expression(gen, gen->depth);
+      fprintf(gen->out, ") {\n");
+      generate_statements(gen, level + 1, depth - 1);
+      indent(gen, level);
+
+      if (chance(gen, 50))
+      {
+        fprintf(gen->out, "} else {\n");
+        generate_statements(gen, level + 1, depth - 1);
+        indent(gen, level);
+      }
+
+      fprintf(gen->out, "}\n");
+      break;
+    default:
+      fprintf(gen->out, "while (");
+      generate_expression(gen, gen->depth);
+      fprintf(gen->out, ") {\n");
+      generate_statements(gen, level + 1, depth - 1);
+      indent(gen, level);
+      fprintf(gen->out, "}\n");
+      break;
+  }
+}
+
+void generate_statements(Generator *gen, int level, int depth)
+{
+  int i;
+  int count = 1 + random_below(gen, 4);
+
+  for (i = 0; i < count; i++)
+    generate_statement(gen, level, depth);
+}
+
+void generate_subroutine(Generator *gen, int index)
+{
+  static const char *kinds[] = {"function", "method", "constructor"};
+  const char *kind = kinds[random_below(gen, COUNT(kinds))];
+  int i;
+  int count;
+
+  maybe_comment(gen, 1);
+  indent(gen, 1);
+
+  if (strcmp(kind, "constructor") == 0)
+    fprintf(gen->out, "constructor %s new%d(", random_word(gen), index);
+  else if (chance(gen, 30))
+    fprintf(gen->out, "%s void %s%d(", kind, random_word(gen), index);
+  else
+    fprintf(gen->out, "%s %s %s%d(", kind, return_types[random_below(gen, COUNT(return_types))],
+            random_word(gen), index);
+
+  count = random_below(gen, 4);
+
+  for (i = 0; i < count; i++)
+    fprintf(gen->out, "%s%s %s%d", i == 0 ? "" : ", ", types[random_below(gen, COUNT(types))], random_word(gen), i);
+
+  fprintf(gen->out, ") {\n");
+
+  count = random_below(gen, 3);
+
+  for (i = 0; i < count; i++)
+  {
+    indent(gen, 2);
+    fprintf(gen->out, "var %s %s, %s%d;\n", types[random_below(gen, COUNT(types))], random_word(gen),
+            random_word(gen), i);
+  }
+
+  generate_statements(gen, 2, gen->depth);
+  indent(gen, 2);
+
+  if (chance(gen, 50))
+  {
+    fprintf(gen->out, "return ");
+    generate_expression(gen, gen->depth);
+    fprintf(gen->out, ";\n");
+  }
+  else
+  {
+    fprintf(gen->out, "return;\n");
+  }
+
+  indent(gen, 1);
+  fprintf(gen->out, "}\n\n");
+}
+
+// Writes a class of about size bytes
+void generate_class(Generator *gen, int index, long size)
+{
+  int i;
+  int count = random_below(gen, 6);
+
+  maybe_comment(gen, 0);
+  fprintf(gen->out, "class Class%04d {\n", index);
+
+  for (i = 0; i < count; i++)
+  {
+    indent(gen, 1);
+    fprintf(gen->out, "%s %s %s, %s%d;\n", chance(gen, 50) ? "static" : "field",
+            types[random_below(gen, COUNT(types))], random_word(gen), random_word(gen), i);
+  }
+
+  fprintf(gen->out, "\n");
+
+  for (i = 0; ftell(gen->out) < size; i++)
+    generate_subroutine(gen, i);
+
+  fprintf(gen->out, "}\n");
+}
+
+void print_usage()
+{
+  fprintf(stderr, "Usage: gen_corpus [-n files] [-b bytes] [-d depth] [-c comments%%] [-s strings%%] [-S seed] directory\n");
+}
+
+int main(int argc, char *argv[])
+{
+  Generator gen;
+  char path[4096];
+  int files = DEFAULT_FILES;
+  long bytes = DEFAULT_BYTES;
+  unsigned long long seed = DEFAULT_SEED;
+  int opt;
+  int i;
+  int j;
+
+  gen.depth = DEFAULT_DEPTH;
+  gen.comments = DEFAULT_COMMENTS;
+  gen.strings = DEFAULT_STRINGS;
+
+  while ((opt = getopt(argc, argv, "n:b:d:c:s:S:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        files = atoi(optarg);
+        break;
+      case 'b':
+        bytes = atol(optarg);
+        break;
+      case 'd':
+        gen.depth = atoi(optarg);
+        break;
+      case 'c':
+        gen.comments = atoi(optarg);
+        break;
+      case 's':
+        gen.strings = atoi(optarg);
+        break;
+      case 'S':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        print_usage();
+        return 1;
+    }
+  }
+
+  if (optind != argc - 1 || files < 1 || bytes < 1 || gen.depth < 0)
+  {
+    print_usage();
+    return 1;
+  }
+
+  if (mkdir(argv[optind], 0777) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Failed to create directory %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  for (i = 0; i < files; i++)
+  {
+    // Every class has its own stream, so a class does not depend on the number of files
+    gen.state = (seed + 1) * 0x9E3779B97F4A7C15ULL + i;
+
+    for (j = 0; j < 8; j++)
+      next_random(&gen);
+
+    snprintf(path, sizeof(path), "%s/Class%04d.jack", argv[optind], i);
+    gen.out = fopen(path, "w");
+
+    if (gen.out == NULL)
+    {
+      fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+
+    generate_class(&gen, i, bytes);
+
+    if (fclose(gen.out) != 0)
+    {
+      fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Runs the analyzer on a generated corpus and compares its throughput with a saved baseline.
+#
+# Usage: bench/run.sh [--save]
+#
+# Each case is run RUNS times and its best run is kept. Throughput is read from
+# --stats=json and covers the wall time of the analysis. --save stores the results
+# as the new baseline, which has to exist before the results can be compared with it.
+# Settings can be overridden from the environment.
+
+ANALYZER=${ANALYZER:-./JackAnalyzer}
+GEN_CORPUS=${GEN_CORPUS:-build/gen_corpus}
+CORPUS=${CORPUS:-build/corpus}
+BASELINE=${BASELINE:-bench/baseline.txt}
+RUNS=${RUNS:-5}
+JOBS=${JOBS:-$(nproc 2>/dev/null || echo 4)}
+
+set -e
+
+if [ "$1" != "--save" ] && [ ! -f "$BASELINE" ]; then
+  echo "No baseline in $BASELINE, run make bench-baseline first" >&2
+  exit 1
+fi
+
+# Single class of 4 MiB and a directory of 64 classes of 64 KiB
+rm -rf "$CORPUS"
+mkdir -p "$CORPUS"
+"$GEN_CORPUS" -n 1 -b 4194304 "$CORPUS/single"
+"$GEN_CORPUS" -n 64 -b 65536 "$CORPUS/dir"
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+# Prints "<bytes per second> <tokens per second>" of the best of RUNS runs
+measure()
+{
+  i=0
+  while [ "$i" -lt "$RUNS" ]; do
+    "$ANALYZER" --stats=json "$@" 2>/dev/null |
+      sed -n 's/.*"total".*"bytes_per_second": \([0-9.]*\), "tokens_per_second": \([0-9.]*\).*/\1 \2/p'
+    i=$((i + 1))
+  done | sort -n -r | head -n 1
+}
+
+echo "single $(measure "$CORPUS/single/Class0000.jack")" >> "$results"
+echo "dir $(measure -j 1 "$CORPUS/dir")" >> "$results"
+echo "parallel $(measure -j "$JOBS" "$CORPUS/dir")" >> "$results"
+
+baseline=$BASELINE
+[ -f "$baseline" ] || baseline=/dev/null
+
+awk -v jobs="$JOBS" '
+  FILENAME == ARGV[1] { base[$1] = $2; next }
+  FNR == 1 {
+    printf "%-14s %10s %14s %14s %8s\n", "case", "MB/s", "tokens/s", "baseline MB/s", "change"
+  }
+  {
+    name = $1 == "parallel" ? "parallel" "(" jobs ")" : $1
+    if ($1 in base && base[$1] > 0)
+      printf "%-14s %10.1f %14.0f %14.1f %+7.1f%%\n", name, $2 / 1e6, $3, base[$1] / 1e6, ($2 / base[$1] - 1) * 100
+    else
+      printf "%-14s %10.1f %14.0f %14s %8s\n", name, $2 / 1e6, $3, "-", "-"
+  }
+' "$baseline" "$results"
+
+if [ "$1" = "--save" ]; then
+  cp "$results" "$BASELINE"
+  echo "Saved baseline to $BASELINE"
+fi